@@ -23,9 +23,24 @@ displayed if any other argument format is given.
 #include <iostream>
 #include <unistd.h> // sleep() etc.
 #include <stdlib.h> // getenv() etc.
+#include <errno.h> // EINVAL etc.
 #include <sys/time.h>
 #include <string>
+#include <string.h> // strlen() etc.
+#include <stdio.h> // snprintf() etc.
 #include <math.h>
+#include <stdint.h>
+
+#ifdef RENDER_BENCHMARK
+#include <dirent.h>
+#endif
+
+#ifdef TRACE_EVENTS
+#include <atomic>
+#include <thread>
+#include <signal.h>
+#include <time.h>
+#endif
 
 // Header files for X functions.
 #include <X11/Xlib.h>
@@ -59,126 +74,1852 @@ const double INITIAL_PADDLE_X = (SCREEN_WIDTH / 2) - (paddleLength / 2);
 const double INITIAL_PADDLE_Y = (SCREEN_HEIGHT - 100);
 
 /*
- * Other parameters.
+ * Other parameters.
+ */
+// Fixed frames per second.
+const double FPS = 60.0;
+
+// Buffersize.
+const int BUFFER_SIZE = 10;
+
+/*
+ * Physics sub-stepping. Each frame is split into substeps so that the ball
+ * and paddle move at most a fraction of the smallest collider per substep,
+ * keeping fast balls from passing through the paddle or a brick.
+ */
+const double SMALLEST_COLLIDER = fmin(fmin(BRICK_HEIGHT, PADDLE_HEIGHT), BALL_DIAMETER);
+const double MAX_SUBSTEP_DISTANCE = 0.25 * SMALLEST_COLLIDER;
+const int MAX_SUBSTEPS = 64;
+
+// Substep counters for simulated frames.
+int lastFrameSubsteps = 0;
+int maxFrameSubsteps = 0;
+unsigned long totalSubsteps = 0;
+unsigned long totalPhysicsFrames = 0;
+
+// Buffer size for the score text, large enough for any int.
+const int SCORE_BUFFER_SIZE = 12;
+
+// Array of speed values for game.
+double speedArray[10] = {1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0};
+
+// Array of length values for paddle length.
+int paddleLengthValues[5] = {70, 80, 90, 100, 110};
+
+// Default ball and paddle speed.
+double ballSpeed = speedArray[5];
+double paddleSpeed = speedArray[5];
+
+// Scoring values.
+int score = 0;
+int destroyBrickPoints = 50.0;
+int paddleBouncePoints = 20.0;
+
+// Boolean game parameters.
+bool showSplash = true;
+bool alive = true;
+bool gameWon = false;
+bool gamePaused = false;
+bool paddleLeft = false;
+bool paddleRight = false;
+
+enum Color {DEAD, RED, GREEN, BLUE, YELLOW, PURPLE, ORANGE};
+
+Color brickArray[NUM_OF_ROWS][NUM_OF_COLS] = { {DEAD} };
+
+// Font parameters.
+const char * FONT_NAME = "12x24";
+const int FONT_CHAR_LENGTH = 12;
+const int FONT_CHAR_HEIGHT = 24;
+
+/*
+ * Sprite atlas parameters. Every static visual is rendered once at
+ * startup into an offscreen atlas and frames are built by copying
+ * regions of the atlas into the back buffer.
+ */
+const int ATLAS_WIDTH = SCREEN_WIDTH;
+const int ATLAS_HEIGHT = 400;
+const int ATLAS_PADDING = 2;
+
+// Region of the sprite atlas holding a single pre-rendered visual.
+struct Sprite {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// Atlas pixmap and the packing cursor used while it is being filled.
+struct SpriteAtlas {
+    Pixmap pixmap;
+    int cursorX;
+    int cursorY;
+    int rowHeight;
+};
+
+// Game sprites. The ball is copied through a 1-bit mask of its shape.
+// paddleSprite is the one for the paddle length of this run.
+Sprite brickSprites[ORANGE + 1];
+Sprite ballSprite;
+Pixmap ballMask;
+Sprite paddleSprites[5];
+Sprite paddleSprite;
+
+// HUD sprites. Only the score changes during a run; it is composed
+// from the digit sprites.
+Sprite digitSprites[10];
+Sprite scoreLabelSprite;
+Sprite ballSpeedSprite;
+Sprite paddleSpeedSprite;
+Sprite paddleLengthSprite;
+
+// Text sprites for the splash, pause, win and lose screens.
+Sprite splashSprites[4];
+Sprite pauseSprite;
+Sprite winSprites[2];
+Sprite loseSprites[2];
+
+// X resources used to draw frames.
+struct Renderer {
+    Display * display;
+    Window window;
+    Pixmap buffer;
+    GC gc;
+    XFontStruct * font;
+    SpriteAtlas atlas;
+    unsigned long brickPixels[ORANGE + 1];
+};
+
+// Score text shown in the HUD. Formatted into a fixed buffer only
+// when the score changes so repaints do not allocate.
+struct ScoreText {
+    char text[SCORE_BUFFER_SIZE];
+    int length;
+    int value;
+};
+
+#ifdef ALLOCATION_GUARD
+// Frames played by the headless allocation check (one minute).
+const int ALLOCATION_CHECK_FRAMES = 60 * 60;
+#endif
+
+#ifdef RENDER_BENCHMARK
+// Frames drawn with each render path per benchmark round.
+const int BENCHMARK_FRAMES = 1000;
+const int BENCHMARK_ROUNDS = 3;
+#endif
+
+void setBrickArray() {
+    bricksRemaining = 0;
+    for (int i = 2; i < 11; i++){
+        brickArray[0][i] = RED;
+        brickArray[1][i] = GREEN;
+        brickArray[2][i] = BLUE;
+        brickArray[3][i] = YELLOW;
+        brickArray[4][i] = PURPLE;
+        brickArray[5][i] = ORANGE;
+        bricksRemaining += 6;
+    }
+}
+
+/*
+ * Allocation guard. Building with -DALLOCATION_GUARD (see "make guard")
+ * replaces the C heap functions, which operator new is built on, so any
+ * heap allocation made while the guard is armed aborts the program. The
+ * game loop arms the guard after the first frame has been presented, and
+ * "make allocation-check" runs a headless game with it. The guard is per
+ * thread so it does not cover the trace flush thread.
+ *
+ * Xlib calls that read input from the server (XPending, XNextEvent,
+ * XFlush) may allocate: libxcb allocates every packet it reads, Xlib
+ * grows its event queue and lazily loads the keyboard mapping. Inside
+ * them allocations are counted instead, and the count is printed at exit.
+ */
+#ifdef ALLOCATION_GUARD
+enum AllocationGuardMode {GUARD_OFF, GUARD_COUNT, GUARD_ABORT};
+
+thread_local AllocationGuardMode allocationGuardMode = GUARD_OFF;
+unsigned long countedAllocations = 0;
+
+extern "C" void * __libc_malloc(size_t size);
+extern "C" void * __libc_calloc(size_t count, size_t size);
+extern "C" void * __libc_realloc(void * ptr, size_t size);
+extern "C" void * __libc_memalign(size_t alignment, size_t size);
+extern "C" void * __libc_valloc(size_t size);
+extern "C" void * __libc_pvalloc(size_t size);
+extern "C" void __libc_free(void * ptr);
+
+/*
+ * Function to abort on a heap allocation while the guard is armed, or
+ * count it inside Xlib input handling. Writes directly to stderr since
+ * the message must not allocate.
+ */
+void check_allocation() {
+
+    if (allocationGuardMode == GUARD_ABORT)
+    {
+        const char message[] = "Heap allocation in steady-state game loop.\n";
+        write(STDERR_FILENO, message, sizeof(message) - 1);
+        abort();
+    }
+    else if (allocationGuardMode == GUARD_COUNT)
+    {
+        countedAllocations++;
+    }
+}
+
+/*
+ * Function to print the number of allocations made inside Xlib input
+ * handling. Registered with atexit().
+ */
+void report_counted_allocations() {
+
+    allocationGuardMode = GUARD_OFF;
+    fprintf(stderr, "Heap allocations inside Xlib input handling: %lu\n", countedAllocations);
+}
+
+extern "C" void * malloc(size_t size) {
+    check_allocation();
+    return __libc_malloc(size);
+}
+
+extern "C" void * calloc(size_t count, size_t size) {
+    check_allocation();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void * realloc(void * ptr, size_t size) {
+    check_allocation();
+    return __libc_realloc(ptr, size);
+}
+
+// Aligned allocations, including aligned operator new, go through these.
+extern "C" void * memalign(size_t alignment, size_t size) {
+    check_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void * aligned_alloc(size_t alignment, size_t size) {
+    check_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void ** ptr, size_t alignment, size_t size) {
+    check_allocation();
+    if (alignment == 0 || alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+    {
+        return EINVAL;
+    }
+    void * result = __libc_memalign(alignment, size);
+    if (result == NULL)
+    {
+        return ENOMEM;
+    }
+    *ptr = result;
+    return 0;
+}
+
+extern "C" void * valloc(size_t size) {
+    check_allocation();
+    return __libc_valloc(size);
+}
+
+extern "C" void * pvalloc(size_t size) {
+    check_allocation();
+    return __libc_pvalloc(size);
+}
+
+extern "C" void free(void * ptr) {
+    __libc_free(ptr);
+}
+
+#define ALLOCATION_GUARD_ARM(armed) (allocationGuardMode = (armed) ? GUARD_ABORT : GUARD_OFF)
+#define ALLOCATION_GUARD_BEGIN_XLIB() \
+    do { if (allocationGuardMode == GUARD_ABORT) allocationGuardMode = GUARD_COUNT; } while (0)
+#define ALLOCATION_GUARD_END_XLIB() \
+    do { if (allocationGuardMode == GUARD_COUNT) allocationGuardMode = GUARD_ABORT; } while (0)
+#else
+#define ALLOCATION_GUARD_ARM(armed)
+#define ALLOCATION_GUARD_BEGIN_XLIB()
+#define ALLOCATION_GUARD_END_XLIB()
+#endif
+
+/*
+ * Function to extract the time in microseconds.
+ */
+unsigned long now() {
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    unsigned long us = tv.tv_sec * 1000000 + tv.tv_usec;
+    return us;
+}
+
+/*
+ * Function to output message on error exit.
+ */
+void error(std::string str) {
+
+    std::cerr << str << std::endl;
+
+    exit(0);
+}
+
+/*
+ * Trace events. Building with -DTRACE_EVENTS (see "make trace") records
+ * spans and instant events of the game loop into per-thread lock-free
+ * rings. A background thread drains the rings into TRACE_FILE_NAME in the
+ * Chrome trace-event format, which chrome://tracing and Perfetto can open.
+ * Recording does not allocate; events are dropped if a ring is full.
+ * Timestamps come from the monotonic clock in nanoseconds. The file is
+ * finished at exit, including exits through error(), Xlib I/O errors and
+ * SIGINT.
+ */
+#ifdef TRACE_EVENTS
+const char * TRACE_FILE_NAME = "breakout_trace.json";
+const unsigned int TRACE_RING_SIZE = 4096;
+const int MAX_TRACE_THREADS = 4;
+const int TRACE_FLUSH_INTERVAL_US = 10000;
+
+// A single trace event. Names must be string literals since they are
+// written out later by the flush thread. Times are in nanoseconds;
+// counter events carry their value instead of a duration.
+struct TraceEvent {
+    const char * name;
+    char phase;
+    unsigned long timestamp;
+    unsigned long duration;
+    long value;
+};
+
+// Single-producer single-consumer ring of trace events. The owning
+// thread pushes at head and the flush thread pops at tail.
+struct TraceRing {
+    TraceEvent events[TRACE_RING_SIZE];
+    std::atomic<unsigned int> head;
+    std::atomic<unsigned int> tail;
+    std::atomic<unsigned long> dropped;
+    int threadId;
+};
+
+TraceRing traceRings[MAX_TRACE_THREADS];
+std::atomic<int> traceRingCount(0);
+thread_local TraceRing * localTraceRing = NULL;
+
+// Output file and flush thread state.
+FILE * traceFile = NULL;
+bool traceFirstEvent = true;
+std::atomic<bool> traceStopping(false);
+std::thread * traceThread = NULL;
+
+// Set by the SIGINT handler; the game loop exits when it is set.
+volatile sig_atomic_t traceInterrupted = 0;
+
+/*
+ * Function to read the monotonic clock in nanoseconds.
+ */
+unsigned long trace_now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/*
+ * Function to get the calling thread's ring, registering it on first use.
+ * Returns NULL if every ring is taken.
+ */
+TraceRing * trace_ring() {
+
+    if (localTraceRing == NULL)
+    {
+        int index = traceRingCount.load(std::memory_order_relaxed);
+        while (index < MAX_TRACE_THREADS
+               && !traceRingCount.compare_exchange_weak(index, index + 1))
+        {
+        }
+        if (index >= MAX_TRACE_THREADS)
+        {
+            return NULL;
+        }
+        traceRings[index].threadId = index + 1;
+        localTraceRing = &traceRings[index];
+    }
+
+    return localTraceRing;
+}
+
+/*
+ * Function to push an event onto the calling thread's ring.
+ */
+void trace_record(const char * name, char phase, unsigned long timestamp,
+                  unsigned long duration, long value) {
+
+    TraceRing * ring = trace_ring();
+    if (ring == NULL)
+    {
+        return;
+    }
+
+    unsigned int head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= TRACE_RING_SIZE)
+    {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    TraceEvent& event = ring->events[head % TRACE_RING_SIZE];
+    event.name = name;
+    event.phase = phase;
+    event.timestamp = timestamp;
+    event.duration = duration;
+    event.value = value;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+/*
+ * Function to record a span that started at the given time and ends now.
+ */
+void trace_complete(const char * name, unsigned long start) {
+    trace_record(name, 'X', start, trace_now() - start, 0);
+}
+
+/*
+ * Function to record an instant event.
+ */
+void trace_instant(const char * name) {
+    trace_record(name, 'i', trace_now(), 0, 0);
+}
+
+/*
+ * Function to record the current value of a counter.
+ */
+void trace_counter(const char * name, long value) {
+    trace_record(name, 'C', trace_now(), 0, value);
+}
+
+/*
+ * Function to write out every event currently in the rings. Only called
+ * from the flush thread.
+ */
+void flush_trace_rings() {
+
+    int numRings = traceRingCount.load(std::memory_order_acquire);
+    if (numRings > MAX_TRACE_THREADS)
+    {
+        numRings = MAX_TRACE_THREADS;
+    }
+
+    for (int i = 0; i < numRings; i++)
+    {
+        TraceRing& ring = traceRings[i];
+        unsigned int tail = ring.tail.load(std::memory_order_relaxed);
+        unsigned int head = ring.head.load(std::memory_order_acquire);
+
+        for (; tail != head; tail++)
+        {
+            const TraceEvent& event = ring.events[tail % TRACE_RING_SIZE];
+
+            // Times are written in microseconds with nanosecond fractions.
+            fprintf(traceFile, "%s\n{\"name\":\"%s\",\"cat\":\"game\",\"ph\":\"%c\","
+                    "\"ts\":%lu.%03lu,\"pid\":1,\"tid\":%d",
+                    traceFirstEvent ? "" : ",", event.name, event.phase,
+                    event.timestamp / 1000, event.timestamp % 1000, ring.threadId);
+            if (event.phase == 'X')
+            {
+                fprintf(traceFile, ",\"dur\":%lu.%03lu}",
+                        event.duration / 1000, event.duration % 1000);
+            }
+            else if (event.phase == 'C')
+            {
+                fprintf(traceFile, ",\"args\":{\"value\":%ld}}", event.value);
+            }
+            else
+            {
+                fprintf(traceFile, ",\"s\":\"t\"}");
+            }
+            traceFirstEvent = false;
+        }
+
+        ring.tail.store(tail, std::memory_order_release);
+    }
+}
+
+/*
+ * Function run by the flush thread. Drains the rings periodically until
+ * the tracer is stopped, then drains them one last time.
+ */
+void trace_flush_loop() {
+
+    while (!traceStopping.load(std::memory_order_acquire))
+    {
+        flush_trace_rings();
+        usleep(TRACE_FLUSH_INTERVAL_US);
+    }
+    flush_trace_rings();
+}
+
+/*
+ * Function to stop the flush thread and finish the trace file. Registered
+ * with atexit() so the file is complete however the game exits.
+ */
+void stop_tracer() {
+
+    if (traceThread == NULL)
+    {
+        return;
+    }
+
+    traceStopping.store(true, std::memory_order_release);
+    traceThread->join();
+    delete traceThread;
+    traceThread = NULL;
+
+    fprintf(traceFile, "\n]}\n");
+    fclose(traceFile);
+    traceFile = NULL;
+
+    for (int i = 0; i < MAX_TRACE_THREADS; i++)
+    {
+        unsigned long dropped = traceRings[i].dropped.load();
+        if (dropped > 0)
+        {
+            std::cerr << "Trace events dropped: " << dropped << std::endl;
+        }
+    }
+}
+
+/*
+ * SIGINT handler. Only sets a flag since exit() is not async-signal-safe;
+ * the game loop exits when it sees the flag.
+ */
+void trace_interrupt(int) {
+    traceInterrupted = 1;
+}
+
+/*
+ * Function to open the trace file and start the flush thread.
+ */
+void start_tracer() {
+
+    traceFile = fopen(TRACE_FILE_NAME, "w");
+    if (traceFile == NULL)
+    {
+        error("Cannot open trace file.");
+    }
+    fprintf(traceFile, "{\"traceEvents\":[");
+
+    traceThread = new std::thread(trace_flush_loop);
+
+    atexit(stop_tracer);
+    signal(SIGINT, trace_interrupt);
+}
+
+#define TRACE_BEGIN(start) unsigned long start = trace_now()
+#define TRACE_END(name, start) trace_complete(name, start)
+#define TRACE_INSTANT(name) trace_instant(name)
+#define TRACE_COUNTER(name, value) trace_counter(name, value)
+#else
+#define TRACE_BEGIN(start)
+#define TRACE_END(name, start)
+#define TRACE_INSTANT(name)
+#define TRACE_COUNTER(name, value)
+#endif
+
+/*
+ * Function to update the substep counters after a simulated frame. Builds
+ * with -DPHYSICS_STATS also log each frame's substep count to stderr,
+ * which is unbuffered so logging does not allocate.
+ */
+void record_frame_substeps(int substepsTaken) {
+
+    lastFrameSubsteps = substepsTaken;
+    if (substepsTaken > maxFrameSubsteps)
+    {
+        maxFrameSubsteps = substepsTaken;
+    }
+    totalSubsteps += substepsTaken;
+    totalPhysicsFrames++;
+    TRACE_COUNTER("Physics substeps", substepsTaken);
+
+#ifdef PHYSICS_STATS
+    fprintf(stderr, "Physics frame %lu: %d substeps\n", totalPhysicsFrames, substepsTaken);
+#endif
+}
+
+/*
+ * Function to print the substep counters. Only enabled when built with
+ * -DPHYSICS_STATS.
+ */
+void print_physics_stats() {
+
+#ifdef PHYSICS_STATS
+    std::cout << "Physics frames: " << totalPhysicsFrames
+              << ", substeps: " << totalSubsteps
+              << ", last frame: " << lastFrameSubsteps
+              << ", max per frame: " << maxFrameSubsteps << std::endl;
+#endif
+}
+
+/*
+ * function: physics_frame. Advances the floating point physics by one frame.
+ * input:    Ball position and direction, paddle position (in pixels), the
+ *           paddle inputs and the time elapsed since the last frame (in seconds).
+ * notes:    Updates the score, bricks and alive state. Does not allocate.
+ */
+void physics_frame(double& ballX, double& ballY, XPoint& ballDir, double& paddleX,
+                   bool paddleLeft, bool paddleRight, float deltaTime) {
+
+    // Split the frame into substeps so that nothing moves more than
+    // MAX_SUBSTEP_DISTANCE per substep. Time beyond MAX_SUBSTEPS
+    // substeps (e.g. after a stalled frame) is dropped.
+    double maxSpeed = fmax(fmax(abs(ballDir.x), abs(ballDir.y)), paddleSpeed);
+    int numSubsteps = (int) ceil(maxSpeed * deltaTime / MAX_SUBSTEP_DISTANCE);
+    if (numSubsteps < 1)
+    {
+        numSubsteps = 1;
+    }
+    if (numSubsteps > MAX_SUBSTEPS)
+    {
+        numSubsteps = MAX_SUBSTEPS;
+        deltaTime = MAX_SUBSTEPS * MAX_SUBSTEP_DISTANCE / maxSpeed;
+    }
+    float substepTime = deltaTime / numSubsteps;
+
+    int substepsTaken = 0;
+    for (int step = 0; step < numSubsteps && alive && bricksRemaining > 0; step++)
+    {
+        substepsTaken++;
+
+        // Determine if ball is in contact with vertical wall.
+        TRACE_BEGIN(wallStart);
+        if ( (ballX + BALL_DIAMETER / 2 >= SCREEN_WIDTH && ballDir.x > 0) 
+            || (ballX - BALL_DIAMETER / 2 <= 0 && ballDir.x < 0) )
+        {
+            ballDir.x = -1*ballDir.x;
+        }
+
+        // Determine if ball is in contact if top wall.
+        if ((ballY - BALL_DIAMETER / 2 <= 0) && (ballDir.y < 0))
+        {
+            ballDir.y = -1*ballDir.y;
+        }
+        TRACE_END("Wall collision", wallStart);
+
+        // Determine if ball is in contact with the paddle.
+        TRACE_BEGIN(paddleStart);
+        if ((ballY + BALL_DIAMETER/2 >= INITIAL_PADDLE_Y)
+            && (ballY + BALL_DIAMETER / 2 <= INITIAL_PADDLE_Y + PADDLE_HEIGHT) 
+            && (ballX + BALL_DIAMETER / 2 >= paddleX)
+            && (ballX <= paddleX + paddleLength)
+            && (ballDir.y > 0)) 
+        {
+            ballDir.y = -1*ballDir.y;
+            score += paddleBouncePoints;
+        }
+        TRACE_END("Paddle collision", paddleStart);
+
+        // Only the bricks around the ball can be hit. The range is
+        // widened by one brick to cover contacts on brick edges.
+        int minRow = (int) floor((ballY - BALL_DIAMETER / 2) / BRICK_HEIGHT) - 1;
+        int maxRow = (int) floor((ballY + BALL_DIAMETER / 2) / BRICK_HEIGHT) + 1;
+        int minCol = (int) floor((ballX - BALL_DIAMETER / 2) / BRICK_WIDTH) - 1;
+        int maxCol = (int) floor((ballX + BALL_DIAMETER / 2) / BRICK_WIDTH) + 1;
+        if (minRow < 0) minRow = 0;
+        if (maxRow > NUM_OF_ROWS - 1) maxRow = NUM_OF_ROWS - 1;
+        if (minCol < 0) minCol = 0;
+        if (maxCol > NUM_OF_COLS - 1) maxCol = NUM_OF_COLS - 1;
+
+        // Vertical brick break.
+        TRACE_BEGIN(verticalStart);
+        for (int row = minRow; row <= maxRow; row++)
+        {
+            for (int col = minCol; col <= maxCol; col++)
+            {
+                if (brickArray[row][col] != DEAD)
+                {
+                    if ((ballX >= col*BRICK_WIDTH)
+                        && (ballX <= (col + 1)*BRICK_WIDTH)
+                        && (ballY + BALL_DIAMETER / 2 >= row*BRICK_HEIGHT)
+                        && (ballY < (row + 1)*BRICK_HEIGHT))
+                    {
+                        brickArray[row][col] = DEAD;
+                        bricksRemaining--;
+                        score += destroyBrickPoints;
+
+                        ballDir.y = -1*ballDir.y;
+                        TRACE_INSTANT("Brick destroyed");
+                    }
+                    else if ((ballX >= col*BRICK_WIDTH)
+                            && (ballX <= (col + 1)*BRICK_WIDTH)
+                            && (ballY - BALL_DIAMETER / 2 <= (row + 1)*BRICK_HEIGHT)
+                            && (ballY > row*BRICK_HEIGHT))
+                    {
+                        brickArray[row][col] = DEAD;
+                        bricksRemaining--;
+                        score += destroyBrickPoints;
+
+                        ballDir.y = -1*ballDir.y;
+                        TRACE_INSTANT("Brick destroyed");
+                    }
+                }
+            }
+        }
+        TRACE_END("Vertical brick collision", verticalStart);
+
+        // Horizontal brick break.
+        TRACE_BEGIN(horizontalStart);
+        for (int row = minRow; row <= maxRow; row++)
+        {
+            for (int col = minCol; col <= maxCol; col++)
+            {
+                if (brickArray[row][col] != DEAD)
+                {
+                    if ((ballY >= row*BRICK_HEIGHT)
+                        && (ballY <= (row + 1)*BRICK_HEIGHT)
+                        && (ballX + BALL_DIAMETER / 2 >= col*BRICK_WIDTH)
+                        && (ballX < (col + 1)*BRICK_WIDTH))
+                    {
+                        brickArray[row][col] = DEAD;
+                        bricksRemaining--;
+                        score += destroyBrickPoints;
+
+                        ballDir.x = -1*ballDir.x;
+                        TRACE_INSTANT("Brick destroyed");
+                    }
+                    else if ((ballY >= row*BRICK_HEIGHT)
+                            && (ballY <= (row + 1)*BRICK_HEIGHT)
+                            && (ballX - BALL_DIAMETER / 2 <= (col + 1)*BRICK_WIDTH)
+                            && (ballX > col*BRICK_WIDTH))
+                    {
+                        brickArray[row][col] = DEAD;
+                        bricksRemaining--;
+                        score += destroyBrickPoints;
+
+                        ballDir.x = -1*ballDir.x;
+                        TRACE_INSTANT("Brick destroyed");
+                    }
+                }
+            }
+        }
+        TRACE_END("Horizontal brick collision", horizontalStart);
+
+        // Update paddle position.
+        if ( paddleLeft && paddleX >= 0)
+        {
+            paddleX -= paddleSpeed*substepTime;
+        }
+        if (paddleRight && paddleX + paddleLength <= SCREEN_WIDTH)
+        {
+            paddleX += paddleSpeed*substepTime;
+        }
+
+        // Update ball position.
+        float ballXIncrement = ballDir.x*substepTime;
+        float ballYIncrement = ballDir.y*substepTime;
+
+        ballX += ballXIncrement;
+        ballY += ballYIncrement;
+
+        // Determine if the incremental ball movement ends
+        // the game by touching the lower edge.
+        if (ballY >= SCREEN_HEIGHT && !gameWon)
+        {
+            alive = false;
+            TRACE_INSTANT("Game lost");
+        }
+    }
+
+    record_frame_substeps(substepsTaken);
+}
+
+#ifdef FIXED_POINT_PHYSICS
+/*
+ * Fixed-point physics. Building with -DFIXED_POINT_PHYSICS (see "make fixed")
+ * simulates the ball and paddle in Q16.16 integer arithmetic at a fixed tick
+ * rate, so a given sequence of inputs produces bit-identical results on any
+ * compiler, optimization level or architecture. Speeds are multiples of
+ * 25 px/s, so at 200 ticks per second they are multiples of 1/8 px per tick
+ * and exact in Q16.16. The fastest ball moves 1.25 px per tick, well under
+ * MAX_SUBSTEP_DISTANCE, so ticks also serve as physics substeps.
+ */
+typedef int32_t fixed;
+const int FIXED_SHIFT = 16;
+const fixed FIXED_ONE = 1 << FIXED_SHIFT;
+const int PHYSICS_TICK_RATE = 200;
+const unsigned long PHYSICS_TICK_US = 1000000 / PHYSICS_TICK_RATE;
+
+// Number of ticks simulated by the headless replay (60 seconds).
+const int REPLAY_TICKS = 60 * PHYSICS_TICK_RATE;
+
+// Ball and paddle state in fixed point. Positions are in pixels and
+// velocities in pixels per tick.
+struct FixedState {
+    fixed ballX;
+    fixed ballY;
+    fixed ballVelX;
+    fixed ballVelY;
+    fixed paddleX;
+    fixed paddleVel;
+};
+
+/*
+ * Function to convert a whole number of pixels to fixed point.
+ */
+fixed to_fixed(int pixels) {
+    return pixels * FIXED_ONE;
+}
+
+/*
+ * Function to convert a fixed point value to pixels.
+ */
+double from_fixed(fixed value) {
+    return (double) value / FIXED_ONE;
+}
+
+/*
+ * Function to reset the ball and paddle positions in fixed point.
+ */
+void reset_fixed_positions(FixedState& state) {
+    state.ballX = to_fixed(INITIAL_BALL_X);
+    state.ballY = to_fixed(INITIAL_BALL_Y);
+    state.paddleX = to_fixed(INITIAL_PADDLE_X);
+}
+
+/*
+ * Function to initialize the fixed point state from the game parameters.
+ * The conversion is exact for speeds that are multiples of 25 px/s.
+ */
+void init_fixed_state(FixedState& state) {
+    reset_fixed_positions(state);
+    state.ballVelX = (int64_t) ballSpeed * FIXED_ONE / PHYSICS_TICK_RATE;
+    state.ballVelY = state.ballVelX;
+    state.paddleVel = (int64_t) paddleSpeed * FIXED_ONE / PHYSICS_TICK_RATE;
+}
+
+/*
+ * function: fixed_physics_tick. Advances the game by one physics tick.
+ * input:    Fixed point state and the paddle inputs for this tick.
+ * notes:    Mirrors the collision tests of the floating point path using
+ *           integer arithmetic only. Updates the score, bricks and alive
+ *           state like the floating point path.
+ */
+void fixed_physics_tick(FixedState& state, bool paddleLeft, bool paddleRight) {
+
+    const fixed radius = to_fixed(BALL_DIAMETER) / 2;
+    const fixed paddleY = to_fixed(INITIAL_PADDLE_Y);
+    const fixed brickWidth = to_fixed(BRICK_WIDTH);
+    const fixed brickHeight = to_fixed(BRICK_HEIGHT);
+
+    // Determine if ball is in contact with vertical wall.
+    TRACE_BEGIN(wallStart);
+    if ( (state.ballX + radius >= to_fixed(SCREEN_WIDTH) && state.ballVelX > 0)
+        || (state.ballX - radius <= 0 && state.ballVelX < 0) )
+    {
+        state.ballVelX = -state.ballVelX;
+    }
+
+    // Determine if ball is in contact if top wall.
+    if ((state.ballY - radius <= 0) && (state.ballVelY < 0))
+    {
+        state.ballVelY = -state.ballVelY;
+    }
+    TRACE_END("Wall collision", wallStart);
+
+    // Determine if ball is in contact with the paddle.
+    TRACE_BEGIN(paddleStart);
+    if ((state.ballY + radius >= paddleY)
+        && (state.ballY + radius <= paddleY + to_fixed(PADDLE_HEIGHT))
+        && (state.ballX + radius >= state.paddleX)
+        && (state.ballX <= state.paddleX + to_fixed(paddleLength))
+        && (state.ballVelY > 0))
+    {
+        state.ballVelY = -state.ballVelY;
+        score += paddleBouncePoints;
+    }
+    TRACE_END("Paddle collision", paddleStart);
+
+    // Only the bricks around the ball can be hit. The range is
+    // widened by one brick to cover contacts on brick edges.
+    int minRow = (state.ballY - radius) / brickHeight - 1;
+    int maxRow = (state.ballY + radius) / brickHeight + 1;
+    int minCol = (state.ballX - radius) / brickWidth - 1;
+    int maxCol = (state.ballX + radius) / brickWidth + 1;
+    if (minRow < 0) minRow = 0;
+    if (maxRow > NUM_OF_ROWS - 1) maxRow = NUM_OF_ROWS - 1;
+    if (minCol < 0) minCol = 0;
+    if (maxCol > NUM_OF_COLS - 1) maxCol = NUM_OF_COLS - 1;
+
+    // Vertical brick break.
+    TRACE_BEGIN(verticalStart);
+    for (int row = minRow; row <= maxRow; row++)
+    {
+        for (int col = minCol; col <= maxCol; col++)
+        {
+            if (brickArray[row][col] != DEAD)
+            {
+                fixed left = col * brickWidth;
+                fixed top = row * brickHeight;
+
+                if ((state.ballX >= left)
+                    && (state.ballX <= left + brickWidth)
+                    && (((state.ballY + radius >= top) && (state.ballY < top + brickHeight))
+                        || ((state.ballY - radius <= top + brickHeight) && (state.ballY > top))))
+                {
+                    brickArray[row][col] = DEAD;
+                    bricksRemaining--;
+                    score += destroyBrickPoints;
+
+                    state.ballVelY = -state.ballVelY;
+                    TRACE_INSTANT("Brick destroyed");
+                }
+            }
+        }
+    }
+    TRACE_END("Vertical brick collision", verticalStart);
+
+    // Horizontal brick break.
+    TRACE_BEGIN(horizontalStart);
+    for (int row = minRow; row <= maxRow; row++)
+    {
+        for (int col = minCol; col <= maxCol; col++)
+        {
+            if (brickArray[row][col] != DEAD)
+            {
+                fixed left = col * brickWidth;
+                fixed top = row * brickHeight;
+
+                if ((state.ballY >= top)
+                    && (state.ballY <= top + brickHeight)
+                    && (((state.ballX + radius >= left) && (state.ballX < left + brickWidth))
+                        || ((state.ballX - radius <= left + brickWidth) && (state.ballX > left))))
+                {
+                    brickArray[row][col] = DEAD;
+                    bricksRemaining--;
+                    score += destroyBrickPoints;
+
+                    state.ballVelX = -state.ballVelX;
+                    TRACE_INSTANT("Brick destroyed");
+                }
+            }
+        }
+    }
+    TRACE_END("Horizontal brick collision", horizontalStart);
+
+    // Update paddle position.
+    if (paddleLeft && state.paddleX >= 0)
+    {
+        state.paddleX -= state.paddleVel;
+    }
+    if (paddleRight && state.paddleX + to_fixed(paddleLength) <= to_fixed(SCREEN_WIDTH))
+    {
+        state.paddleX += state.paddleVel;
+    }
+
+    // Update ball position.
+    state.ballX += state.ballVelX;
+    state.ballY += state.ballVelY;
+
+    // Determine if the movement ends the game by touching the lower edge.
+    if (state.ballY >= to_fixed(SCREEN_HEIGHT))
+    {
+        alive = false;
+        TRACE_INSTANT("Game lost");
+    }
+}
+
+/*
+ * Function to fold the game state into a running FNV-1a hash.
+ */
+uint64_t hash_fixed_state(uint64_t hash, const FixedState& state) {
+
+    const fixed values[] = {state.ballX, state.ballY, state.ballVelX, state.ballVelY,
+                            state.paddleX, score, bricksRemaining, alive};
+
+    for (unsigned int i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        uint32_t value = values[i];
+        for (int byte = 0; byte < 4; byte++)
+        {
+            hash ^= (value >> (8 * byte)) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    return hash;
+}
+
+/*
+ * function: replay_hash. Plays a scripted game headlessly and hashes it.
+ * output:   Hash of the game state after every tick.
+ * notes:    The paddle follows the ball, so the replay exercises wall, paddle
+ *           and brick collisions. Two builds agree on the hash only if their
+ *           physics is bit-identical.
+ */
+uint64_t replay_hash() {
+
+    FixedState state;
+    init_fixed_state(state);
+    setBrickArray();
+    score = 0;
+    alive = true;
+
+    uint64_t hash = 14695981039346656037ULL;
+    for (int tick = 0; tick < REPLAY_TICKS && alive && bricksRemaining > 0; tick++)
+    {
+        fixed paddleCenter = state.paddleX + to_fixed(paddleLength) / 2;
+        bool left = state.ballX < paddleCenter - to_fixed(BRICK_WIDTH) / 4;
+        bool right = state.ballX > paddleCenter + to_fixed(BRICK_WIDTH) / 4;
+
+        fixed_physics_tick(state, left, right);
+        hash = hash_fixed_state(hash, state);
+    }
+
+    return hash;
+}
+#endif
+
+/*
+ * function: Create_simple_window. Creates a window with a black background
+ *           in the given size.
+ * input:    Display, size of the window (in pixels), and location of the window's
+ *           left corner (in pixels).
+ * output:   Window's ID.
+ * notes:    Window is created with a white border, 5 pixels wide.
+ *           the window is automatically mapped after its creation.
+ */
+Window create_simple_window(Display* display, 
+                            const int SCREEN_WIDTH, 
+                            const int WINDOW_HEIGHT, 
+                            const int WINDOW_CORNER_X, 
+                            const int WINDOW_CORNER_Y) {
+    
+    // Returns the default screen number referenced by the XOpenDisplay() function.
+    int screen_number = DefaultScreen(display);
+
+    Window window;
+    /* create a simple window, as a direct child of the screen's */
+    /* root window. Use the screen's black and white colors as   */
+    /* the foreground and background colors of the window,       */
+    /* respectively. Place the new window's top-left corner at   */
+    /* the given 'x,y' coordinates.                              */
+    window = XCreateSimpleWindow(display,
+                                RootWindow(display, screen_number),
+                                WINDOW_CORNER_X,
+                                WINDOW_CORNER_Y, 
+                                SCREEN_WIDTH,
+                                WINDOW_HEIGHT,
+                                BORDER_WIDTH,
+                                WhitePixel(display, screen_number),
+                                BlackPixel(display, screen_number));
+    
+    // Make the window actually appear on the screen.
+    XMapWindow(display, window);
+
+    // Flush all pending requests to the X server. 
+    XFlush(display);
+
+    // Set event to monitor window.
+    XSelectInput(display, window, KeyPressMask | KeyReleaseMask);
+
+    // Window name.
+    XStoreName(display, window, "BREAKOUT!");
+
+    return window;
+}
+
+/*
+ * function: allocate_sprite. Reserves a region of the sprite atlas.
+ * input:    Atlas and size of the sprite (in pixels).
+ * output:   Sprite describing the reserved region.
+ * notes:    Regions are packed left to right in rows; a new row is
+ *           started when the current one is full.
+ */
+Sprite allocate_sprite(SpriteAtlas& atlas, int width, int height) {
+
+    if (atlas.cursorX + width > ATLAS_WIDTH)
+    {
+        atlas.cursorX = 0;
+        atlas.cursorY += atlas.rowHeight + ATLAS_PADDING;
+        atlas.rowHeight = 0;
+    }
+
+    if (width > ATLAS_WIDTH || atlas.cursorY + height > ATLAS_HEIGHT)
+    {
+        error("Sprite atlas is full.");
+    }
+
+    Sprite sprite = {atlas.cursorX, atlas.cursorY, width, height};
+
+    atlas.cursorX += width + ATLAS_PADDING;
+    if (height > atlas.rowHeight)
+    {
+        atlas.rowHeight = height;
+    }
+
+    return sprite;
+}
+
+/*
+ * function: render_rectangle_sprite. Renders a filled rectangle into the atlas.
+ * input:    Display, atlas, GC, fill color and size of the rectangle (in pixels).
+ * output:   Sprite holding the rectangle.
+ */
+Sprite render_rectangle_sprite(Display* display, SpriteAtlas& atlas, GC gc,
+                               unsigned long pixel, int width, int height) {
+
+    Sprite sprite = allocate_sprite(atlas, width, height);
+
+    XSetForeground(display, gc, pixel);
+    XFillRectangle(display, atlas.pixmap, gc, sprite.x, sprite.y, width, height);
+
+    return sprite;
+}
+
+/*
+ * function: render_ball_sprite. Renders the ball into the atlas.
+ * input:    Display, atlas and GC.
+ * output:   Sprite holding the ball; ballMask is set to its 1-bit shape.
+ * notes:    The sprite is square, so it must be drawn through ballMask to
+ *           avoid covering what is underneath its corners (e.g. the paddle).
+ */
+Sprite render_ball_sprite(Display* display, SpriteAtlas& atlas, GC gc) {
+
+    Sprite sprite = allocate_sprite(atlas, BALL_DIAMETER, BALL_DIAMETER);
+
+    XSetForeground(display, gc, WhitePixel(display, DefaultScreen(display)));
+    XFillArc(display, atlas.pixmap, gc, sprite.x, sprite.y,
+            BALL_DIAMETER, BALL_DIAMETER, 0*64, 360*64);
+
+    // Drawing a 1-bit pixmap needs a GC of the same depth.
+    ballMask = XCreatePixmap(display, atlas.pixmap, BALL_DIAMETER, BALL_DIAMETER, 1);
+    GC maskGC = XCreateGC(display, ballMask, 0, NULL);
+
+    XSetForeground(display, maskGC, 0);
+    XFillRectangle(display, ballMask, maskGC, 0, 0, BALL_DIAMETER, BALL_DIAMETER);
+    XSetForeground(display, maskGC, 1);
+    XFillArc(display, ballMask, maskGC, 0, 0,
+            BALL_DIAMETER, BALL_DIAMETER, 0*64, 360*64);
+
+    XFreeGC(display, maskGC);
+
+    return sprite;
+}
+
+/*
+ * function: render_text_sprite. Renders a line of text into the atlas.
+ * input:    Display, atlas, GC, font and text.
+ * output:   Sprite holding the text, including the image string background.
+ * notes:    The sprite's top edge is font->ascent pixels above the baseline.
+ */
+Sprite render_text_sprite(Display* display, SpriteAtlas& atlas, GC gc,
+                          XFontStruct* font, std::string text) {
+
+    Sprite sprite = allocate_sprite(atlas,
+                                    XTextWidth(font, text.c_str(), text.length()),
+                                    font->ascent + font->descent);
+
+    XSetForeground(display, gc, WhitePixel(display, DefaultScreen(display)));
+    XSetBackground(display, gc, BlackPixel(display, DefaultScreen(display)));
+    XDrawImageString(display, atlas.pixmap, gc,
+                    sprite.x, sprite.y + font->ascent,
+                    text.c_str(), text.length());
+
+    return sprite;
+}
+
+/*
+ * function: build_sprite_atlas. Renders every static visual of the game.
+ * input:    Display, window, GC, font and the pixel value of each brick color.
+ * output:   Atlas pixmap; the sprite globals describe its contents.
+ * notes:    Must be called after the command-line arguments are processed
+ *           since the HUD text depends on the game parameters.
+ */
+SpriteAtlas build_sprite_atlas(Display* display, Window window, GC gc,
+                               XFontStruct* font, unsigned long brickPixels[]) {
+
+    int depth = DefaultDepth(display, DefaultScreen(display));
+
+    SpriteAtlas atlas;
+    atlas.pixmap = XCreatePixmap(display, window, ATLAS_WIDTH, ATLAS_HEIGHT, depth);
+    atlas.cursorX = 0;
+    atlas.cursorY = 0;
+    atlas.rowHeight = 0;
+
+    XSetForeground(display, gc, BlackPixel(display, DefaultScreen(display)));
+    XFillRectangle(display, atlas.pixmap, gc, 0, 0, ATLAS_WIDTH, ATLAS_HEIGHT);
+
+    // Bricks, one per color.
+    for (int color = RED; color <= ORANGE; color++)
+    {
+        brickSprites[color] = render_rectangle_sprite(display, atlas, gc,
+                                                      brickPixels[color],
+                                                      BRICK_WIDTH - 5, BRICK_HEIGHT - 5);
+    }
+
+    // Ball.
+    ballSprite = render_ball_sprite(display, atlas, gc);
+
+    // Paddle, one per selectable length.
+    for (int i = 0; i < 5; i++)
+    {
+        paddleSprites[i] = render_rectangle_sprite(display, atlas, gc,
+                                                   WhitePixel(display, DefaultScreen(display)),
+                                                   paddleLengthValues[i], PADDLE_HEIGHT);
+    }
+
+    // Paddle of this run. Runs without a paddle length argument keep the
+    // default length, which is not one of the selectable ones.
+    bool paddleFound = false;
+    for (int i = 0; i < 5; i++)
+    {
+        if (paddleLengthValues[i] == paddleLength)
+        {
+            paddleSprite = paddleSprites[i];
+            paddleFound = true;
+        }
+    }
+    if (!paddleFound)
+    {
+        paddleSprite = render_rectangle_sprite(display, atlas, gc,
+                                               WhitePixel(display, DefaultScreen(display)),
+                                               paddleLength, PADDLE_HEIGHT);
+    }
+
+    // Score digits are rendered as one strip and split into glyphs.
+    Sprite digitStrip = render_text_sprite(display, atlas, gc, font, "0123456789");
+    for (int i = 0; i < 10; i++)
+    {
+        digitSprites[i].x = digitStrip.x + i * digitStrip.width / 10;
+        digitSprites[i].y = digitStrip.y;
+        digitSprites[i].width = digitStrip.width / 10;
+        digitSprites[i].height = digitStrip.height;
+    }
+
+    // HUD text. Game parameters do not change during a run.
+    scoreLabelSprite = render_text_sprite(display, atlas, gc, font, "Score: ");
+    ballSpeedSprite = render_text_sprite(display, atlas, gc, font,
+            "Ball Speed: " + std::to_string( (short) (ceil(ballSpeed*100)/100)));
+    paddleSpeedSprite = render_text_sprite(display, atlas, gc, font,
+            "Paddle speed: " + std::to_string( (short) (ceil(paddleSpeed*100)/100)));
+    paddleLengthSprite = render_text_sprite(display, atlas, gc, font,
+            "Paddle length: " + std::to_string(paddleLength));
+
+    // Splash, pause, win and lose screens.
+    splashSprites[0] = render_text_sprite(display, atlas, gc, font, "Breakout!");
+    splashSprites[1] = render_text_sprite(display, atlas, gc, font, "Created by: Christopher Mannes");
+    splashSprites[2] = render_text_sprite(display, atlas, gc, font,
+            "Press left and right arrow keys to move the paddle.");
+    splashSprites[3] = render_text_sprite(display, atlas, gc, font,
+            "Press p to pause, q to quit, and spacebar to start.");
+
+    pauseSprite = render_text_sprite(display, atlas, gc, font,
+            "Game paused. Press spacebar to continue.");
+
+    winSprites[0] = render_text_sprite(display, atlas, gc, font, "Congratulations! Game complete.");
+    winSprites[1] = render_text_sprite(display, atlas, gc, font, "Press spacebar to play again.");
+
+    loseSprites[0] = render_text_sprite(display, atlas, gc, font, "Game Over! You lose.");
+    loseSprites[1] = render_text_sprite(display, atlas, gc, font, "Press spacebar to play again.");
+
+    return atlas;
+}
+
+/*
+ * function: draw_sprite. Copies a sprite from the atlas.
+ * input:    Display, atlas, destination drawable, GC, sprite and location
+ *           of the sprite's top-left corner in the destination (in pixels).
+ */
+void draw_sprite(Display* display, const SpriteAtlas& atlas, Drawable dest, GC gc,
+                 const Sprite& sprite, int x, int y) {
+
+    XCopyArea(display, atlas.pixmap, dest, gc,
+            sprite.x, sprite.y, sprite.width, sprite.height, x, y);
+}
+
+/*
+ * function: draw_masked_sprite. Copies a sprite through a clip mask.
+ * input:    Display, atlas, destination drawable, GC, sprite, 1-bit mask of
+ *           the sprite's size and location of the sprite's top-left corner
+ *           in the destination (in pixels).
+ * notes:    Only pixels set in the mask are copied, so whatever was drawn
+ *           underneath shows through the rest of the sprite's rectangle.
+ */
+void draw_masked_sprite(Display* display, const SpriteAtlas& atlas, Drawable dest, GC gc,
+                        const Sprite& sprite, Pixmap mask, int x, int y) {
+
+    XSetClipMask(display, gc, mask);
+    XSetClipOrigin(display, gc, x, y);
+    draw_sprite(display, atlas, dest, gc, sprite, x, y);
+    XSetClipMask(display, gc, None);
+}
+
+/*
+ * function: draw_centered_text. Copies a text sprite centered on the screen.
+ * input:    Display, atlas, destination drawable, GC, font, sprite and
+ *           baseline of the text (in pixels).
+ */
+void draw_centered_text(Display* display, const SpriteAtlas& atlas, Drawable dest, GC gc,
+                        XFontStruct* font, const Sprite& sprite, int baseline) {
+
+    int numChars = sprite.width / FONT_CHAR_LENGTH;
+
+    draw_sprite(display, atlas, dest, gc, sprite,
+                SCREEN_WIDTH / 2 - numChars/2 * FONT_CHAR_LENGTH,
+                baseline - font->ascent);
+}
+
+/*
+ * Function to re-format the score text, only when the score has changed.
+ */
+void update_score_text(ScoreText& scoreText) {
+
+    if (score != scoreText.value)
+    {
+        scoreText.length = snprintf(scoreText.text, sizeof(scoreText.text), "%d", score);
+        scoreText.value = score;
+    }
+}
+
+/*
+ * function: draw_frame. Draws the current game state into the back buffer
+ *           by copying sprites from the atlas.
+ * input:    Renderer, score text and ball and paddle positions (in pixels).
+ */
+void draw_frame(Renderer& renderer, ScoreText& scoreText,
+                double ballX, double ballY, double paddleX) {
+
+    Display * display = renderer.display;
+    Pixmap pixmap = renderer.buffer;
+    GC gc = renderer.gc;
+    XFontStruct * font = renderer.font;
+    const SpriteAtlas& atlas = renderer.atlas;
+
+    XSetForeground( display, gc, BlackPixel( display, DefaultScreen(display) ) );
+    XSetBackground( display, gc, BlackPixel( display, DefaultScreen(display) ) );
+
+    XFillRectangle(display, pixmap, gc, 0, 0, SCREEN_WIDTH, WINDOW_HEIGHT);
+
+    if (!showSplash)
+    {
+        // Draw game text.
+        TRACE_BEGIN(hudStart);
+        int hudY = WINDOW_HEIGHT - STATS_OFFSET - font->ascent;
+        int scoreX = SCREEN_WIDTH / 6 + 75;
+
+        draw_sprite(display, atlas, pixmap, gc, scoreLabelSprite, scoreX, hudY);
+
+        // Compose the score from the digit sprites.
+        update_score_text(scoreText);
+        for (int i = 0; i < scoreText.length; i++)
+        {
+            draw_sprite(display, atlas, pixmap, gc, digitSprites[scoreText.text[i] - '0'],
+                        scoreX + scoreLabelSprite.width + i * digitSprites[0].width, hudY);
+        }
+
+        draw_sprite(display, atlas, pixmap, gc, ballSpeedSprite,
+                    2*SCREEN_WIDTH / 6 + 10, hudY);
+        draw_sprite(display, atlas, pixmap, gc, paddleSpeedSprite,
+                    3*SCREEN_WIDTH / 6 - 15, hudY);
+        draw_sprite(display, atlas, pixmap, gc, paddleLengthSprite,
+                    4*SCREEN_WIDTH / 6 - 15, hudY);
+        TRACE_END("HUD text", hudStart);
+
+        // Draw paddle.
+        draw_sprite(display, atlas, pixmap, gc, paddleSprite, paddleX, INITIAL_PADDLE_Y);
+
+        // Draw ball
+        draw_masked_sprite(display, atlas, pixmap, gc, ballSprite, ballMask,
+                           ballX - BALL_DIAMETER / 2, ballY - BALL_DIAMETER / 2);
+
+        // Draw bricks.
+        TRACE_BEGIN(brickDrawStart);
+        for (int row = 0; row < NUM_OF_ROWS; row++)
+        {
+            for (int col = 0; col < NUM_OF_COLS; col++)
+            {
+                if (brickArray[row][col] != DEAD)
+                {
+                    draw_sprite(display, atlas, pixmap, gc, brickSprites[brickArray[row][col]],
+                                col * BRICK_WIDTH, row * BRICK_HEIGHT);
+                }
+            }
+        }
+        TRACE_END("Brick drawing", brickDrawStart);
+    }
+
+    if (alive == true && gameWon == true)
+    {
+        draw_centered_text(display, atlas, pixmap, gc, font, winSprites[0],
+                           SCREEN_HEIGHT / 2 - FONT_CHAR_HEIGHT - 5);
+        draw_centered_text(display, atlas, pixmap, gc, font, winSprites[1],
+                           SCREEN_HEIGHT / 2);
+    }
+
+    if (alive == false && gameWon == false)
+    {
+        draw_centered_text(display, atlas, pixmap, gc, font, loseSprites[0],
+                           SCREEN_HEIGHT / 2 - FONT_CHAR_HEIGHT - 5);
+        draw_centered_text(display, atlas, pixmap, gc, font, loseSprites[1],
+                           SCREEN_HEIGHT / 2);
+    }
+
+    if (gamePaused == true && alive == true && !showSplash)
+    {
+        draw_centered_text(display, atlas, pixmap, gc, font, pauseSprite,
+                           SCREEN_HEIGHT / 2);
+    }
+
+    if (showSplash)
+    {
+        draw_centered_text(display, atlas, pixmap, gc, font, splashSprites[0],
+                           SCREEN_HEIGHT / 2 - FONT_CHAR_HEIGHT - 5);
+        draw_centered_text(display, atlas, pixmap, gc, font, splashSprites[1],
+                           SCREEN_HEIGHT / 2);
+        draw_centered_text(display, atlas, pixmap, gc, font, splashSprites[2],
+                           SCREEN_HEIGHT / 2 + FONT_CHAR_HEIGHT + 5);
+        draw_centered_text(display, atlas, pixmap, gc, font, splashSprites[3],
+                           SCREEN_HEIGHT / 2 + 2*(FONT_CHAR_HEIGHT + 5));
+    }
+}
+
+/*
+ * function: draw_centered_string. Draws a line of text centered on the screen.
+ * input:    Display, destination drawable, GC, text and baseline of the text
+ *           (in pixels).
+ */
+void draw_centered_string(Display* display, Drawable dest, GC gc,
+                          const char * text, int baseline) {
+
+    int length = strlen(text);
+
+    XDrawImageString(display, dest, gc,
+                    SCREEN_WIDTH / 2 - length/2 * FONT_CHAR_LENGTH,
+                    baseline, text, length);
+}
+
+/*
+ * function: draw_frame_legacy. Draws the current game state into the back
+ *           buffer with X drawing primitives, as the game did before the
+ *           sprite atlas.
+ * input:    Renderer, score text and ball and paddle positions (in pixels).
+ * notes:    Used by -DLEGACY_RENDER builds and the render benchmark. Text is
+ *           formatted into stack buffers instead of std::strings and the
+ *           font is not reloaded per frame, so the X server sees the same
+ *           drawing requests as before without the client-side allocations.
+ */
+void draw_frame_legacy(Renderer& renderer, ScoreText& scoreText,
+                       double ballX, double ballY, double paddleX) {
+
+    Display * display = renderer.display;
+    Pixmap pixmap = renderer.buffer;
+    GC gc = renderer.gc;
+
+    XSetForeground( display, gc, BlackPixel( display, DefaultScreen(display) ) );
+    XSetBackground( display, gc, BlackPixel( display, DefaultScreen(display) ) );
+
+    XFillRectangle(display, pixmap, gc, 0, 0, SCREEN_WIDTH, WINDOW_HEIGHT);
+
+    XSetForeground( display, gc, WhitePixel( display, DefaultScreen(display) ) );
+    XSetBackground( display, gc, BlackPixel( display, DefaultScreen(display) ) );
+
+    if (!showSplash)
+    {
+        // Draw game text.
+        char scoreLine[32];
+        char ballSpeedText[32];
+        char paddleSpeedText[32];
+        char paddleLengthText[32];
+
+        update_score_text(scoreText);
+        snprintf(scoreLine, sizeof(scoreLine), "Score: %s", scoreText.text);
+        snprintf(ballSpeedText, sizeof(ballSpeedText), "Ball Speed: %d",
+                 (short) (ceil(ballSpeed*100)/100));
+        snprintf(paddleSpeedText, sizeof(paddleSpeedText), "Paddle speed: %d",
+                 (short) (ceil(paddleSpeed*100)/100));
+        snprintf(paddleLengthText, sizeof(paddleLengthText), "Paddle length: %d", paddleLength);
+
+        XDrawImageString(display, pixmap, gc,
+                        SCREEN_WIDTH  / 6 + 75,
+                        WINDOW_HEIGHT - STATS_OFFSET,
+                        scoreLine, strlen(scoreLine));
+
+        XDrawImageString(display, pixmap, gc,
+                        2*SCREEN_WIDTH / 6 + 10,
+                        WINDOW_HEIGHT - STATS_OFFSET,
+                        ballSpeedText, strlen(ballSpeedText));
+
+        XDrawImageString(display, pixmap, gc,
+                        3*SCREEN_WIDTH / 6 - 15,
+                        WINDOW_HEIGHT - STATS_OFFSET,
+                        paddleSpeedText, strlen(paddleSpeedText));
+
+        XDrawImageString(display, pixmap, gc,
+                        4*SCREEN_WIDTH / 6 - 15,
+                        WINDOW_HEIGHT - STATS_OFFSET,
+                        paddleLengthText, strlen(paddleLengthText));
+
+        // Draw paddle.
+        XFillRectangle(display, pixmap, gc, 
+                        paddleX, INITIAL_PADDLE_Y, paddleLength, PADDLE_HEIGHT);
+
+        // Draw ball
+        XFillArc(display, pixmap, gc,
+                ballX - BALL_DIAMETER / 2, ballY - BALL_DIAMETER / 2, 
+                BALL_DIAMETER, BALL_DIAMETER, 0*64, 360*64);
+
+        // Draw bricks.
+        for (int row = 0; row < NUM_OF_ROWS; row++)
+        {
+            for (int col = 0; col < NUM_OF_COLS; col++)
+            {
+                if (brickArray[row][col] != DEAD)
+                {
+                    XSetForeground(display, gc, renderer.brickPixels[brickArray[row][col]]);
+                    XFillRectangle(display, pixmap, gc,
+                            col * BRICK_WIDTH, row * BRICK_HEIGHT,
+                            BRICK_WIDTH - 5, BRICK_HEIGHT - 5);
+                }
+            }
+        }
+    }
+
+    XSetForeground( display, gc, WhitePixel( display, DefaultScreen(display) ) );
+    XSetBackground( display, gc, BlackPixel( display, DefaultScreen(display) ) );
+
+    if (alive == true && gameWon == true)
+    {
+        draw_centered_string(display, pixmap, gc, "Congratulations! Game complete.",
+                             SCREEN_HEIGHT / 2 - FONT_CHAR_HEIGHT - 5);
+        draw_centered_string(display, pixmap, gc, "Press spacebar to play again.",
+                             SCREEN_HEIGHT / 2);
+    }
+
+    if (alive == false && gameWon == false)
+    {
+        draw_centered_string(display, pixmap, gc, "Game Over! You lose.",
+                             SCREEN_HEIGHT / 2 - FONT_CHAR_HEIGHT - 5);
+        draw_centered_string(display, pixmap, gc, "Press spacebar to play again.",
+                             SCREEN_HEIGHT / 2);
+    }
+
+    if (gamePaused == true && alive == true && !showSplash)
+    {
+        draw_centered_string(display, pixmap, gc, "Game paused. Press spacebar to continue.",
+                             SCREEN_HEIGHT / 2);
+    }
+
+    if (showSplash)
+    {
+        draw_centered_string(display, pixmap, gc, "Breakout!",
+                             SCREEN_HEIGHT / 2 - FONT_CHAR_HEIGHT - 5);
+        draw_centered_string(display, pixmap, gc, "Created by: Christopher Mannes",
+                             SCREEN_HEIGHT / 2);
+        draw_centered_string(display, pixmap, gc,
+                             "Press left and right arrow keys to move the paddle.",
+                             SCREEN_HEIGHT / 2 + FONT_CHAR_HEIGHT + 5);
+        draw_centered_string(display, pixmap, gc,
+                             "Press p to pause, q to quit, and spacebar to start.",
+                             SCREEN_HEIGHT / 2 + 2*(FONT_CHAR_HEIGHT + 5));
+    }
+}
+
+/*
+ * Function to copy the back buffer to the window and flush it to the X server.
+ * Allocations during XFlush are only counted since it can read pending input.
+ * A frame's requests fit in Xlib's output buffer, so drawing them does not
+ * flush on its own.
  */
-// Fixed frames per second.
-const double FPS = 60.0;
+void present_frame(Renderer& renderer) {
 
-// Buffersize.
-const int BUFFER_SIZE = 10;
+    TRACE_BEGIN(presentStart);
+    XCopyArea(renderer.display, renderer.buffer, renderer.window, renderer.gc, 
+            0, 0, SCREEN_WIDTH, WINDOW_HEIGHT, 0, 0);
 
-// Array of speed values for game.
-double speedArray[10] = {1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0};
+    ALLOCATION_GUARD_BEGIN_XLIB();
+    XFlush( renderer.display );
+    ALLOCATION_GUARD_END_XLIB();
+    TRACE_END("Present", presentStart);
+}
 
-// Array of length values for paddle length.
-int paddleLengthValues[5] = {70, 80, 90, 100, 110};
+#ifdef ALLOCATION_GUARD
+/*
+ * function: allocation_check. Plays a scripted game headlessly with the
+ *           allocation guard armed after the first frame.
+ * notes:    Runs the frame logic that does not need a display: physics and
+ *           HUD text. The paddle follows the ball and the game restarts when
+ *           it is won or lost. Returns only if nothing was allocated; any
+ *           allocation aborts the program.
+ */
+void allocation_check() {
 
-// Default ball and paddle speed.
-double ballSpeed = speedArray[5];
-double paddleSpeed = speedArray[5];
+    ScoreText scoreText;
+    scoreText.length = 0;
+    scoreText.value = -1;
 
-// Scoring values.
-int score = 0;
-int destroyBrickPoints = 50.0;
-int paddleBouncePoints = 20.0;
+    double ballX = INITIAL_BALL_X;
+    double ballY = INITIAL_BALL_Y;
+    double paddleX = INITIAL_PADDLE_X;
+#ifdef FIXED_POINT_PHYSICS
+    FixedState fixedState;
+    init_fixed_state(fixedState);
+#else
+    XPoint ballDir;
+    ballDir.x = ballSpeed;
+    ballDir.y = ballSpeed;
+#endif
 
-// Boolean game parameters.
-bool showSplash = true;
-bool alive = true;
-bool gameWon = false;
-bool gamePaused = false;
-bool paddleLeft = false;
-bool paddleRight = false;
+    setBrickArray();
+    showSplash = false;
+    score = 0;
+    int gamesPlayed = 1;
 
-enum Color {DEAD, RED, GREEN, BLUE, YELLOW, PURPLE, ORANGE};
+    for (int frame = 0; frame < ALLOCATION_CHECK_FRAMES; frame++)
+    {
+        // Re-start game after winning or losing.
+        if (!alive || bricksRemaining <= 0)
+        {
+            paddleX = INITIAL_PADDLE_X;
+            ballX = INITIAL_BALL_X;
+            ballY = INITIAL_BALL_Y;
+            score = 0;
+            setBrickArray();
+#ifdef FIXED_POINT_PHYSICS
+            reset_fixed_positions(fixedState);
+#endif
+            alive = true;
+            gamesPlayed++;
+        }
 
-Color brickArray[NUM_OF_ROWS][NUM_OF_COLS] = { {DEAD} };
+        // Chase the ball once it is in the lower half of the screen.
+        bool chasing = ballY > SCREEN_HEIGHT / 2;
+        bool paddleLeft = chasing && ballX < paddleX + paddleLength / 2 - BRICK_WIDTH / 4;
+        bool paddleRight = chasing && ballX > paddleX + paddleLength / 2 + BRICK_WIDTH / 4;
 
-void setBrickArray() {
-    bricksRemaining = 0;
-    for (int i = 2; i < 11; i++){
-        brickArray[0][i] = RED;
-        brickArray[1][i] = GREEN;
-        brickArray[2][i] = BLUE;
-        brickArray[3][i] = YELLOW;
-        brickArray[4][i] = PURPLE;
-        brickArray[5][i] = ORANGE;
-        bricksRemaining += 6;
+#ifdef FIXED_POINT_PHYSICS
+        for (int tick = 0; tick < PHYSICS_TICK_RATE / FPS && alive && bricksRemaining > 0; tick++)
+        {
+            fixed_physics_tick(fixedState, paddleLeft, paddleRight);
+        }
+        ballX = from_fixed(fixedState.ballX);
+        ballY = from_fixed(fixedState.ballY);
+        paddleX = from_fixed(fixedState.paddleX);
+#else
+        physics_frame(ballX, ballY, ballDir, paddleX, paddleLeft, paddleRight, 1 / FPS);
+#endif
+        update_score_text(scoreText);
+
+        // Everything after the first frame must not allocate.
+        ALLOCATION_GUARD_ARM(true);
     }
+    ALLOCATION_GUARD_ARM(false);
+
+    printf("No heap allocations in %d frames (%d games).\n",
+           ALLOCATION_CHECK_FRAMES, gamesPlayed);
 }
+#endif
 
+#ifdef RENDER_BENCHMARK
 /*
- * Function to extract the time in microseconds.
+ * Function to find the X server's process ID by scanning /proc for a known
+ * X server name. XSERVER_PID overrides the lookup.
  */
-unsigned long now() {
-    timeval tv;
-    gettimeofday(&tv, NULL);
-    unsigned long us = tv.tv_sec * 1000000 + tv.tv_usec;
-    return us;
+int find_xserver_pid() {
+
+    const char * override = getenv("XSERVER_PID");
+    if (override != NULL)
+    {
+        return atoi(override);
+    }
+
+    const char * serverNames[] = {"Xorg", "X", "Xvfb", "Xwayland", "Xephyr", "Xvnc"};
+
+    DIR * proc = opendir("/proc");
+    if (proc == NULL)
+    {
+        return 0;
+    }
+
+    int pid = 0;
+    struct dirent * entry;
+    while (pid == 0 && (entry = readdir(proc)) != NULL)
+    {
+        char path[300];
+        char name[64];
+        snprintf(path, sizeof(path), "/proc/%s/comm", entry->d_name);
+
+        FILE * comm = fopen(path, "r");
+        if (comm == NULL)
+        {
+            continue;
+        }
+        if (fgets(name, sizeof(name), comm) != NULL)
+        {
+            name[strcspn(name, "\n")] = '\0';
+            for (unsigned int i = 0; i < sizeof(serverNames) / sizeof(serverNames[0]); i++)
+            {
+                if (strcmp(name, serverNames[i]) == 0)
+                {
+                    pid = atoi(entry->d_name);
+                }
+            }
+        }
+        fclose(comm);
+    }
+    closedir(proc);
+
+    return pid;
 }
 
 /*
- * Function to output message on error exit.
+ * Function to read a process's CPU time (user plus system) in seconds
+ * from /proc/<pid>/stat.
  */
-void error(std::string str) {
+double process_cpu_seconds(int pid) {
 
-    std::cerr << str << std::endl;
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
 
-    exit(0);
+    FILE * stat = fopen(path, "r");
+    if (stat == NULL)
+    {
+        error("Cannot read X server CPU time.");
+    }
+
+    // The command name may contain spaces, so skip to its closing
+    // parenthesis. utime and stime are fields 14 and 15.
+    char line[1024];
+    if (fgets(line, sizeof(line), stat) == NULL)
+    {
+        error("Cannot read X server CPU time.");
+    }
+    fclose(stat);
+
+    char * fields = strrchr(line, ')');
+    unsigned long utime = 0;
+    unsigned long stime = 0;
+    if (fields == NULL
+        || sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                  &utime, &stime) != 2)
+    {
+        error("Cannot parse X server CPU time.");
+    }
+
+    return (double) (utime + stime) / sysconf(_SC_CLK_TCK);
 }
 
 /*
- * function: Create_simple_window. Creates a window with a black background
- *           in the given size.
- * input:    Display, size of the window (in pixels), and location of the window's
- *           left corner (in pixels).
- * output:   Window's ID.
- * notes:    Window is created with a white border, 5 pixels wide.
- *           the window is automatically mapped after its creation.
+ * function: benchmark_frames. Draws and presents frames with one render path.
+ * input:    Renderer, score text, render path, number of frames and X server
+ *           process ID.
+ * output:   X server CPU time per frame (in milliseconds).
+ * notes:    XSync after each frame makes the X server finish the frame before
+ *           the next one is sent. The ball and paddle move every frame and a
+ *           brick is destroyed every few frames so that frames differ.
  */
-Window create_simple_window(Display* display, 
-                            const int SCREEN_WIDTH, 
-                            const int WINDOW_HEIGHT, 
-                            const int WINDOW_CORNER_X, 
-                            const int WINDOW_CORNER_Y) {
-    
-    // Returns the default screen number referenced by the XOpenDisplay() function.
-    int screen_number = DefaultScreen(display);
+double benchmark_frames(Renderer& renderer, ScoreText& scoreText, bool legacy,
+                        int frames, int xserverPid) {
 
-    Window window;
-    /* create a simple window, as a direct child of the screen's */
-    /* root window. Use the screen's black and white colors as   */
-    /* the foreground and background colors of the window,       */
-    /* respectively. Place the new window's top-left corner at   */
-    /* the given 'x,y' coordinates.                              */
-    window = XCreateSimpleWindow(display,
-                                RootWindow(display, screen_number),
-                                WINDOW_CORNER_X,
-                                WINDOW_CORNER_Y, 
-                                SCREEN_WIDTH,
-                                WINDOW_HEIGHT,
-                                BORDER_WIDTH,
-                                WhitePixel(display, screen_number),
-                                BlackPixel(display, screen_number));
-    
-    // Make the window actually appear on the screen.
-    XMapWindow(display, window);
+    setBrickArray();
+    score = 0;
 
-    // Flush all pending requests to the X server. 
-    XFlush(display);
+    XSync(renderer.display, False);
+    double cpuStart = process_cpu_seconds(xserverPid);
 
-    // Set event to monitor window.
-    XSelectInput(display, window, KeyPressMask | KeyReleaseMask);
+    for (int frame = 0; frame < frames; frame++)
+    {
+        double ballX = 50 + (frame * 7) % (SCREEN_WIDTH - 100);
+        double ballY = 50 + (frame * 5) % (SCREEN_HEIGHT - 100);
+        double paddleX = (frame * 3) % (SCREEN_WIDTH - paddleLength);
 
-    // Window name.
-    XStoreName(display, window, "BREAKOUT!");
+        if (frame % 8 == 0)
+        {
+            int brick = (frame / 8) % (NUM_OF_ROWS * NUM_OF_COLS);
+            brickArray[brick / NUM_OF_COLS][brick % NUM_OF_COLS] = DEAD;
+            score += destroyBrickPoints;
+        }
+        if (brickArray[0][2] == DEAD && brickArray[5][10] == DEAD)
+        {
+            setBrickArray();
+        }
 
-    return window;
+        if (legacy)
+        {
+            draw_frame_legacy(renderer, scoreText, ballX, ballY, paddleX);
+        }
+        else
+        {
+            draw_frame(renderer, scoreText, ballX, ballY, paddleX);
+        }
+        present_frame(renderer);
+        XSync(renderer.display, False);
+    }
+
+    return (process_cpu_seconds(xserverPid) - cpuStart) * 1000 / frames;
+}
+
+/*
+ * Function to compare the X server CPU time per frame of the sprite atlas
+ * and legacy render paths, alternating between them to even out drift.
+ */
+void run_render_benchmark(Renderer& renderer, ScoreText& scoreText) {
+
+    int xserverPid = find_xserver_pid();
+    if (xserverPid == 0)
+    {
+        error("Cannot find the X server process. Set XSERVER_PID.");
+    }
+
+    showSplash = false;
+    double atlasMs = 0;
+    double legacyMs = 0;
+    for (int round = 0; round < BENCHMARK_ROUNDS; round++)
+    {
+        atlasMs += benchmark_frames(renderer, scoreText, false, BENCHMARK_FRAMES, xserverPid);
+        legacyMs += benchmark_frames(renderer, scoreText, true, BENCHMARK_FRAMES, xserverPid);
+    }
+
+    printf("X server CPU per frame over %d frames each (pid %d):\n",
+           BENCHMARK_ROUNDS * BENCHMARK_FRAMES, xserverPid);
+    printf("  sprite atlas: %.4f ms\n", atlasMs / BENCHMARK_ROUNDS);
+    printf("  legacy:       %.4f ms\n", legacyMs / BENCHMARK_ROUNDS);
 }
+#endif
 
 // Enter main program.
 int main(int argc, char * argv[]) {
 
+#ifdef FIXED_POINT_PHYSICS
+    // Print the hash of a headless replay with the default game parameters.
+    if (argc == 2 && std::string(argv[1]) == "--replay-hash")
+    {
+        ballSpeed = 25*speedArray[5];
+        paddleSpeed = 25*speedArray[7];
+        paddleLength = 80;
+        printf("%016llx\n", (unsigned long long) replay_hash());
+        return(0);
+    }
+#endif
+
+#ifdef ALLOCATION_GUARD
+    // Check the frame logic for allocations with the default game parameters.
+    if (argc == 2 && std::string(argv[1]) == "--allocation-check")
+    {
+        ballSpeed = 25*speedArray[5];
+        paddleSpeed = 25*speedArray[7];
+        paddleLength = 80;
+        allocation_check();
+        return(0);
+    }
+#endif
+
+#ifdef RENDER_BENCHMARK
+    // Compare the render paths with the default game parameters.
+    bool runBenchmark = (argc == 2 && std::string(argv[1]) == "--render-benchmark");
+    if (runBenchmark)
+    {
+        argc = 1;
+    }
+#endif
+
     // Read command-line arguments and procees game parameters.
     if (argc == 1) 
     {
@@ -232,10 +1973,13 @@ int main(int argc, char * argv[]) {
     // Allocate a new GC graphic context object for drawing in the window.
 
     // Which values in "values" to check when creating GC
-    unsigned long valueMask = 0;		
+    unsigned long valueMask = GCGraphicsExposures;		
 
-    // Initial values for the GC.
+    // Initial values for the GC. Frames are built from many XCopyArea
+    // calls; without graphics exposures off, the X server sends a
+    // NoExpose event for each of them.
     XGCValues values;		           	
+    values.graphics_exposures = False;
 	GC gc = XCreateGC(display, window, valueMask, &values);
 	XWindowAttributes w;
 	XGetWindowAttributes(display, window, &w);
@@ -265,6 +2009,50 @@ int main(int argc, char * argv[]) {
 	int depth = DefaultDepth(display, DefaultScreen(display));
 	Pixmap buffer = XCreatePixmap(display, window, SCREEN_WIDTH, WINDOW_HEIGHT, depth);
 
+    // Load the font once; it is only needed to render the atlas.
+    XFontStruct * font = XLoadQueryFont(display, FONT_NAME);
+    if (font == NULL) {
+        error("Cannot load font.");
+    }
+    XSetFont(display, gc, font->fid);
+
+    // Pixel value of each brick color, indexed by Color.
+    unsigned long brickPixels[ORANGE + 1];
+    brickPixels[DEAD] = BlackPixel(display, DefaultScreen(display));
+    brickPixels[RED] = red.pixel;
+    brickPixels[GREEN] = green.pixel;
+    brickPixels[BLUE] = blue.pixel;
+    brickPixels[YELLOW] = yellow.pixel;
+    brickPixels[PURPLE] = purple.pixel;
+    brickPixels[ORANGE] = orange.pixel;
+
+    // Render all static visuals once.
+    Renderer renderer;
+    renderer.display = display;
+    renderer.window = window;
+    renderer.buffer = buffer;
+    renderer.gc = gc;
+    renderer.font = font;
+    renderer.atlas = build_sprite_atlas(display, window, gc, font, brickPixels);
+    for (int color = DEAD; color <= ORANGE; color++)
+    {
+        renderer.brickPixels[color] = brickPixels[color];
+    }
+
+    // Score text shown in the HUD.
+    ScoreText scoreText;
+    scoreText.length = 0;
+    scoreText.value = -1;
+
+#ifdef RENDER_BENCHMARK
+    if (runBenchmark)
+    {
+        run_render_benchmark(renderer, scoreText);
+        XCloseDisplay(display);
+        return(0);
+    }
+#endif
+
     // Initialize bricks by setBrickArray.
     setBrickArray();
 
@@ -272,16 +2060,24 @@ int main(int argc, char * argv[]) {
     double ballX = INITIAL_BALL_X;
     double ballY = INITIAL_BALL_Y;
 
+#ifndef FIXED_POINT_PHYSICS
     XPoint ballDir;
     ballDir.x = ballSpeed;
     ballDir.y = ballSpeed;
+#endif
 
     // Paddle position and velocity.
     double paddleX = INITIAL_PADDLE_X;
-    const double paddleY = INITIAL_PADDLE_Y; 
 	bool paddleLeft = false;
 	bool paddleRight = false;
 
+#ifdef FIXED_POINT_PHYSICS
+    // Fixed point state and the simulated time not yet consumed by ticks.
+    FixedState fixedState;
+    init_fixed_state(fixedState);
+    unsigned long tickAccumulator = 0;
+#endif
+
     // Save time of last logic update.
     unsigned long lastUpdate = now();
 
@@ -291,8 +2087,30 @@ int main(int argc, char * argv[]) {
     // Event handle for current event.
     XEvent event;
 
+#ifdef ALLOCATION_GUARD
+    // Report allocations counted inside Xlib input handling.
+    atexit(report_counted_allocations);
+#endif
+
+#ifdef TRACE_EVENTS
+    // Record the game loop until the program exits.
+    start_tracer();
+#endif
+
     while (true) 
     {
+#ifdef TRACE_EVENTS
+        // Exit through exit() so the trace file is finished.
+        if (traceInterrupted)
+        {
+            TRACE_INSTANT("Game interrupted");
+            XCloseDisplay(display);
+            exit(0);
+        }
+#endif
+
+        TRACE_BEGIN(eventStart);
+        ALLOCATION_GUARD_BEGIN_XLIB();
         if (XPending(display) > 0)
         {
             XNextEvent(display, &event);
@@ -318,6 +2136,7 @@ int main(int argc, char * argv[]) {
                     if (i == 1 && text[0] == ' ' && showSplash == true)
                     {
                         showSplash = false;
+                        TRACE_INSTANT("Game started");
                     }
                     // Re-start game after losing.
                     else if (i == 1 && text[0] == ' ' && alive == false)
@@ -327,9 +2146,13 @@ int main(int argc, char * argv[]) {
                         ballY = INITIAL_BALL_Y;
                         score = 0;
                         setBrickArray();
+#ifdef FIXED_POINT_PHYSICS
+                        reset_fixed_positions(fixedState);
+#endif
 
                         // Reset alive.
                         alive = true;
+                        TRACE_INSTANT("Game restarted");
                     }
                     // Re-start game after winning.
                     else if (i == 1 && text[0] == ' ' && gameWon == true)
@@ -339,24 +2162,32 @@ int main(int argc, char * argv[]) {
                         ballY = INITIAL_BALL_Y;
                         score = 0;
                         setBrickArray();
+#ifdef FIXED_POINT_PHYSICS
+                        reset_fixed_positions(fixedState);
+#endif
 
                         // Reset gameWon.
                         gameWon = false;
+                        TRACE_INSTANT("Game restarted");
                     }
 
                     // Pause game.
                     if (i == 1 && text[0] == 'p' && !gamePaused)
                     {
                         gamePaused = true;
+                        TRACE_INSTANT("Game paused");
                     }
                     // Unpause game.
                     if (i == 1 && text[0] == ' ' && gamePaused)
                     {
                         gamePaused = false;
+                        TRACE_INSTANT("Game resumed");
                     }
                     // Quit game.
                     if (i == 1 && text[0] == 'q')
                     {
+                        print_physics_stats();
+                        TRACE_INSTANT("Game quit");
                         XCloseDisplay(display);
                         exit(0);
                     }
@@ -401,347 +2232,85 @@ int main(int argc, char * argv[]) {
                 }
             }
         }
+        ALLOCATION_GUARD_END_XLIB();
+        TRACE_END("Event handling", eventStart);
+
         // Get current time in microseconds.
         unsigned long end = now();
 
+#ifndef FIXED_POINT_PHYSICS
         // Get time increment for determining the distance increment.
         float deltaTime = (end - lastUpdate) / 1000000.0;
+#endif
 
         // Deterimine if the game is won.
         if (alive && bricksRemaining <= 0 && !gameWon)
         {
             gameWon = true;
+            TRACE_INSTANT("Game won");
         }
 
         // Determine if the game logic should be executed.
+#ifdef FIXED_POINT_PHYSICS
         if (alive && bricksRemaining > 0 && !gameWon && !gamePaused && !showSplash)
         {
-            // Determine if ball is in contact with vertical wall.
-            if ( (ballX + BALL_DIAMETER / 2 >= SCREEN_WIDTH && ballDir.x > 0) 
-                || (ballX - BALL_DIAMETER / 2 <= 0 && ballDir.x < 0) )
-            {
-                ballDir.x = -1*ballDir.x;
-            }
-
-            // Determine if ball is in contact if top wall.
-            if ((ballY - BALL_DIAMETER / 2 <= 0) && (ballDir.y < 0))
-            {
-                ballDir.y = -1*ballDir.y;
-            }
+            // Run whole ticks for the elapsed time. Time beyond MAX_SUBSTEPS
+            // ticks (e.g. after a stalled frame) is dropped.
+            tickAccumulator += end - lastUpdate;
 
-            // Determine if ball is in contact with the paddle.
-            if ((ballY + BALL_DIAMETER/2 >= paddleY)
-                && (ballY + BALL_DIAMETER / 2 <= paddleY + PADDLE_HEIGHT) 
-                && (ballX + BALL_DIAMETER / 2 >= paddleX)
-                && (ballX <= paddleX + paddleLength)
-                && (ballDir.y > 0)) 
+            int substepsTaken = 0;
+            while (tickAccumulator >= PHYSICS_TICK_US && alive && bricksRemaining > 0)
             {
-                ballDir.y = -1*ballDir.y;
-                score += paddleBouncePoints;
-            }
-
-            // Vertical brick break.
-            for (int row = 0; row < NUM_OF_ROWS; row++)
-            {
-                for (int col = 0; col < NUM_OF_COLS; col++)
-                {
-                    if (brickArray[row][col] != DEAD)
-                    {
-                        if ((ballX >= col*BRICK_WIDTH)
-                            && (ballX <= (col + 1)*BRICK_WIDTH)
-                            && (ballY + BALL_DIAMETER / 2 >= row*BRICK_HEIGHT)
-                            && (ballY < (row + 1)*BRICK_HEIGHT))
-                        {
-                            brickArray[row][col] = DEAD;
-                            bricksRemaining--;
-                            score += destroyBrickPoints;
-
-                            ballDir.y = -1*ballDir.y;
-                        }
-                        else if ((ballX >= col*BRICK_WIDTH)
-                                && (ballX <= (col + 1)*BRICK_WIDTH)
-                                && (ballY - BALL_DIAMETER / 2 <= (row + 1)*BRICK_HEIGHT)
-                                && (ballY > row*BRICK_HEIGHT))
-                        {
-                            brickArray[row][col] = DEAD;
-                            bricksRemaining--;
-                            score += destroyBrickPoints;
-
-                            ballDir.y = -1*ballDir.y;
-                        }
-                    }
-                }
-            }
+                fixed_physics_tick(fixedState, paddleLeft, paddleRight);
+                tickAccumulator -= PHYSICS_TICK_US;
 
-            // Horizontal brick break.
-            for (int row = 0; row < NUM_OF_ROWS; row++)
-            {
-                for (int col = 0; col < NUM_OF_COLS; col++)
+                substepsTaken++;
+                if (substepsTaken == MAX_SUBSTEPS)
                 {
-                    if (brickArray[row][col] != DEAD)
-                    {
-                        if ((ballY >= row*BRICK_HEIGHT)
-                            && (ballY <= (row + 1)*BRICK_HEIGHT)
-                            && (ballX + BALL_DIAMETER / 2 >= col*BRICK_WIDTH)
-                            && (ballX < (col + 1)*BRICK_WIDTH))
-                        {
-                            brickArray[row][col] = DEAD;
-                            bricksRemaining--;
-                            score += destroyBrickPoints;
-
-                            ballDir.x = -1*ballDir.x;
-                        }
-                        else if ((ballY >= row*BRICK_HEIGHT)
-                                && (ballY <= (row + 1)*BRICK_HEIGHT)
-                                && (ballX - BALL_DIAMETER / 2 <= (col + 1)*BRICK_WIDTH)
-                                && (ballX > col*BRICK_WIDTH))
-                        {
-                            brickArray[row][col] = DEAD;
-                            bricksRemaining--;
-                            score += destroyBrickPoints;
-
-                            ballDir.x = -1*ballDir.x;
-                        }
-                    }
+                    tickAccumulator = 0;
                 }
             }
 
-            // Update paddle position.
-            if ( paddleLeft && paddleX >= 0)
-            {
-                paddleX -= paddleSpeed*deltaTime;
-            }
-            if (paddleRight && paddleX + paddleLength <= SCREEN_WIDTH)
-            {
-                paddleX += paddleSpeed*deltaTime;
-            }
-
-            // Update ball position.
-            float ballXIncrement = ballDir.x*deltaTime;
-            float ballYIncrement = ballDir.y*deltaTime;
+            // Positions used for drawing.
+            ballX = from_fixed(fixedState.ballX);
+            ballY = from_fixed(fixedState.ballY);
+            paddleX = from_fixed(fixedState.paddleX);
 
-            ballX += ballXIncrement;
-            ballY += ballYIncrement;
-
-            // Determine if the incremental ball movement ends
-            // the game by touching the lower edge.
-            if (ballY >= SCREEN_HEIGHT && !gameWon)
-            {
-                alive = false;
-            }
+            record_frame_substeps(substepsTaken);
+        }
+        else
+        {
+            tickAccumulator = 0;
+        }
+#else
+        if (alive && bricksRemaining > 0 && !gameWon && !gamePaused && !showSplash)
+        {
+            physics_frame(ballX, ballY, ballDir, paddleX, paddleLeft, paddleRight, deltaTime);
         }
+#endif
 
         lastUpdate = now();
         if (end - lastRepaint > 1000000/FPS )
         {
-            Pixmap pixmap;
-            pixmap = buffer;
-
-		    XFontStruct * font;
-		    font = XLoadQueryFont (display, "12x24");
-			XSetFont (display, gc, font->fid);
-			const int FONT_CHAR_LENGTH = 12;
-			const int FONT_CHAR_HEIGHT = 24;
-
-            XSetForeground( display, gc, BlackPixel( display, DefaultScreen(display) ) );
-            XSetBackground( display, gc, BlackPixel( display, DefaultScreen(display) ) );
-
-            XFillRectangle(display, pixmap, gc, 0, 0, SCREEN_WIDTH, WINDOW_HEIGHT);
-
-            if (!showSplash)
-            {
-                XSetForeground( display, gc, WhitePixel( display, DefaultScreen(display) ) );
-                XSetBackground( display, gc, BlackPixel( display, DefaultScreen(display) ) );
-
-                // Draw game text.
-                std::string scoreText("Score: " + std::to_string(score));
-                std::string ballSpeedText("Ball Speed: " + std::to_string( (short) (ceil(ballSpeed*100)/100)));
-                std::string paddleSpeedText("Paddle speed: " + std::to_string( (short) (ceil(paddleSpeed*100)/100)));
-                std::string paddleLengthText("Paddle length: " + std::to_string(paddleLength));
-
-                XDrawImageString(display, pixmap, gc,
-                                SCREEN_WIDTH  / 6 + 75,
-                                WINDOW_HEIGHT - STATS_OFFSET,
-                                scoreText.c_str(),
-                                scoreText.length());
-
-                XDrawImageString(display, pixmap, gc,
-                                2*SCREEN_WIDTH / 6 + 10,
-                                WINDOW_HEIGHT - STATS_OFFSET,
-                                ballSpeedText.c_str(),
-                                ballSpeedText.length());
-
-                XDrawImageString(display, pixmap, gc,
-                                3*SCREEN_WIDTH / 6 - 15,
-                                WINDOW_HEIGHT - STATS_OFFSET,
-                                paddleSpeedText.c_str(),
-                                paddleSpeedText.length());
-
-                XDrawImageString(display, pixmap, gc,
-                                4*SCREEN_WIDTH / 6 - 15,
-                                WINDOW_HEIGHT - STATS_OFFSET,
-                                paddleLengthText.c_str(),
-                                paddleLengthText.length());
-
-                // Draw paddle.
-                XFillRectangle(display, pixmap, gc, 
-                                paddleX, paddleY, paddleLength, PADDLE_HEIGHT);
-
-                // Draw ball
-                XFillArc(display, pixmap, gc,
-                        ballX - BALL_DIAMETER / 2, ballY - BALL_DIAMETER / 2, 
-                        BALL_DIAMETER, BALL_DIAMETER, 0*64, 360*64);
-
-                // Draw bricks.GREEN, BLUE, YELLOW, PURPLE, ORANGE
-                for (int row = 0; row < NUM_OF_ROWS; row++)
-                {
-                    for (int col = 0; col < NUM_OF_COLS; col++)
-                    {
-                        if (brickArray[row][col] != DEAD)
-                        {
-                            switch(brickArray[row][col])
-                            {
-                                case DEAD:
-                                {
-                                    XSetForeground(display, gc, BlackPixel( display, DefaultScreen(display) ) );
-                                    break; 
-                                }
-                                case RED:
-                                {
-                                    XSetForeground(display, gc, red.pixel);
-                                    break; 
-                                }
-                                case GREEN:
-                                {
-                                    XSetForeground(display, gc, green.pixel);
-                                    break; 
-                                }
-                                case BLUE:
-                                {
-                                    XSetForeground(display, gc, blue.pixel);
-                                    break; 
-                                }
-                                case YELLOW:
-                                {
-                                    XSetForeground(display, gc, yellow.pixel);
-                                    break; 
-                                }
-                                case PURPLE:
-                                {
-                                    XSetForeground(display, gc, purple.pixel);
-                                    break; 
-                                }
-                                case ORANGE:
-                                {
-                                    XSetForeground(display, gc, orange.pixel);
-                                    break; 
-                                }
-                            }
-                            XFillRectangle(display, pixmap, gc,
-                                    col * BRICK_WIDTH, row * BRICK_HEIGHT,
-                                    BRICK_WIDTH - 5, BRICK_HEIGHT - 5);
-                        }
-                    }
-                }
-
-            }
-
-            if (alive == true && gameWon == true)
-            {
-                XSetForeground( display, gc, WhitePixel( display, DefaultScreen(display) ) );
-                XSetBackground( display, gc, BlackPixel( display, DefaultScreen(display) ) );
-
-                std::string winText1("Congratulations! Game complete.");
-                std::string winText2("Press spacebar to play again.");
-
-                XDrawImageString(display, pixmap, gc,
-                                SCREEN_WIDTH / 2 - winText1.length()/2 * FONT_CHAR_LENGTH,
-                                SCREEN_HEIGHT / 2 - FONT_CHAR_HEIGHT - 5,
-                                winText1.c_str(),
-                                winText1.length());
-
-                XDrawImageString(display, pixmap, gc,
-                                SCREEN_WIDTH / 2 - winText2.length()/2 * FONT_CHAR_LENGTH,
-                                SCREEN_HEIGHT/2,
-                                winText2.c_str(),
-                                winText2.length());
-            }
-
-            if (alive == false && gameWon == false)
-            {
-                XSetForeground( display, gc, WhitePixel( display, DefaultScreen(display) ) );
-                XSetBackground( display, gc, BlackPixel( display, DefaultScreen(display) ) );
-
-                std::string loseText1("Game Over! You lose.");
-                std::string loseText2("Press spacebar to play again.");
-
-                XDrawImageString(display, pixmap, gc,
-                                SCREEN_WIDTH / 2 - loseText1.length()/2 * FONT_CHAR_LENGTH,
-                                SCREEN_HEIGHT / 2 - FONT_CHAR_HEIGHT - 5,
-                                loseText1.c_str(),
-                                loseText1.length());
-
-                XDrawImageString(display, pixmap, gc,
-                                SCREEN_WIDTH / 2 - loseText2.length()/2 * FONT_CHAR_LENGTH,
-                                SCREEN_HEIGHT / 2,
-                                loseText2.c_str(),
-                                loseText2.length());
-            }
-
-            if (gamePaused == true && alive == true && !showSplash)
-            {
-                XSetForeground( display, gc, WhitePixel( display, DefaultScreen(display) ) );
-                XSetBackground( display, gc, BlackPixel( display, DefaultScreen(display) ) );
-
-                std::string pauseText("Game paused. Press spacebar to continue.");
-
-                XDrawImageString(display, pixmap, gc,
-                                SCREEN_WIDTH / 2 - pauseText.length()/2 * FONT_CHAR_LENGTH,
-                                SCREEN_HEIGHT / 2,
-                                pauseText.c_str(),
-                                pauseText.length());
-            }
-
-            if (showSplash)
-            {
-                XSetForeground( display, gc, WhitePixel( display, DefaultScreen(display) ) );
-                XSetBackground( display, gc, BlackPixel( display, DefaultScreen(display) ) );
-
-                std::string titleText("Breakout!");
-                std::string creatorText("Created by: Christopher Mannes");
-                std::string instructionText1("Press left and right arrow keys to move the paddle.");
-                std::string instructionText2("Press p to pause, q to quit, and spacebar to start.");
-
-                XDrawImageString(display, pixmap, gc,
-                                SCREEN_WIDTH / 2 - (titleText.length()/2 * FONT_CHAR_LENGTH ),
-                                SCREEN_HEIGHT/2 - FONT_CHAR_HEIGHT - 5,
-                                titleText.c_str(), titleText.length());
-
-                XDrawImageString(display, pixmap, gc,
-                                SCREEN_WIDTH / 2 - (creatorText.length()/2 * FONT_CHAR_LENGTH ),
-                                SCREEN_HEIGHT / 2,
-                                creatorText.c_str(), creatorText.length());
-
-                XDrawImageString(display, pixmap, gc,
-                                SCREEN_WIDTH / 2 - (instructionText1.length()/2 * FONT_CHAR_LENGTH ),
-                                SCREEN_HEIGHT / 2 + FONT_CHAR_HEIGHT + 5,
-                                instructionText1.c_str(), instructionText1.length());
-
-                XDrawImageString(display, pixmap, gc,
-                                SCREEN_WIDTH / 2 - (instructionText2.length()/2 * FONT_CHAR_LENGTH ),
-                                SCREEN_HEIGHT / 2 + 2*(FONT_CHAR_HEIGHT + 5),
-                                instructionText2.c_str(), instructionText2.length());	
-            }
-            // copy buffer to window
-            XCopyArea(display, pixmap, window, gc, 
-                    0, 0, SCREEN_WIDTH, WINDOW_HEIGHT, 0, 0);
-
-            XFlush( display );
+#ifdef LEGACY_RENDER
+            draw_frame_legacy(renderer, scoreText, ballX, ballY, paddleX);
+#else
+            draw_frame(renderer, scoreText, ballX, ballY, paddleX);
+#endif
+            present_frame(renderer);
 
             lastRepaint = now(); // remember when the paint happened   
+
+            // Nothing after the first frame may allocate outside Xlib
+            // input handling.
+            ALLOCATION_GUARD_ARM(true);
         }
+
 		// IMPORTANT: sleep for a bit to let other processes work.
-        if (XPending(display) == 0)
+        ALLOCATION_GUARD_BEGIN_XLIB();
+        bool eventsPending = XPending(display) > 0;
+        ALLOCATION_GUARD_END_XLIB();
+        if (!eventsPending)
         {
             usleep(1000000 / FPS - (now() - lastRepaint));
         }